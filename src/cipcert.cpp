@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -15,6 +16,8 @@
 #define MSG std::cout << "cipcert: "
 #endif
 
+static bool extract{true};
+
 auto param(int argc, char *argv[]) {
   std::vector<const char *> checks{
       "reset.cir", "transition.cir", "property.cir",
@@ -24,8 +27,14 @@ auto param(int argc, char *argv[]) {
     std::cout << VERSION << '\n';
     exit(0);
   }
+  if (argc > 1 && !strcmp(argv[1], "--no-extract")) {
+    extract = false;
+    std::copy(argv + 2, argv + argc, argv + 1);
+    --argc;
+  }
   if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " <model.cip> <witness.cip> [";
+    std::cerr << "Usage: " << argv[0]
+              << " [--no-extract] <model.cip> <witness.cip> [";
     for (const char *o : checks)
       std::cerr << " <" << o << ">";
     std::cerr << " ]\n";
@@ -113,7 +122,7 @@ void reset(const char *path, const Cip &witness, const Cip &model,
   for (auto l : extension)
     check.vars[l - 1] = QVarType::ForAll;
   std::ofstream os { path };
-  os << check;
+  os << (extract ? qextract(check) : check);
 }
 
 void transition(const char *path, const Cip &witness, const Cip &model,
@@ -129,7 +138,7 @@ void transition(const char *path, const Cip &witness, const Cip &model,
   for (auto l : next_extension)
     check.vars[l - 1] = QVarType::ForAll;
   std::ofstream os { path };
-  os << check;
+  os << (extract ? qextract(check) : check);
 }
 
 void property(const char *path, const Cip &witness, const Cip &model,
@@ -145,7 +154,7 @@ void property(const char *path, const Cip &witness, const Cip &model,
   for (auto l : extension)
     check.vars[l - 1] = QVarType::ForAll;
   std::ofstream os { path };
-  os << check;
+  os << (extract ? qextract(check) : check);
 }
 
 void base(const char *path, const Cip &witness) {
@@ -158,7 +167,7 @@ void base(const char *path, const Cip &witness) {
       )) };
   // expect exists(S') !(INIT' => -TARGET') = UNSAT
   std::ofstream os { path };
-  os << check;
+  os << (extract ? qextract(check) : check);
 }
 
 void step(const char *path, const Cip &witness) {
@@ -173,7 +182,7 @@ void step(const char *path, const Cip &witness) {
       )) };
   // expect exists(S') !(-TARGET0' ^ TRANS' => -TARGET1') = UNSAT
   std::ofstream os { path };
-  os << check;
+  os << (extract ? qextract(check) : check);
 }
 
 int main(int argc, char **argv) {
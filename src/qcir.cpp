@@ -1,10 +1,36 @@
 #include "qcir.hpp"
 
 #include <algorithm>
+#include <bit>
+#include <map>
 #include <numeric>
+#include <optional>
+#include <set>
+
+// Definition of a variable recovered from its Tseitin clauses.
+struct QDef {
+  QGateType type;
+  std::vector<ssize_t> lits;
+  bool negated;
+  std::vector<size_t> clauses;
+};
+// Clauses of a single conjunction, indexed by their sorted literals.
+struct QClauses {
+  std::map<std::vector<ssize_t>, size_t> ids;
+  std::map<ssize_t, std::vector<const std::vector<ssize_t> *>> occurs;
+  std::set<size_t> used;
+};
 
 static QRef shift_ref(const QRef &ref, ssize_t shift);
 static QRef merge_cir(QCir &left, const QCir &right);
+static std::optional<size_t> find_clause(const QClauses &index,
+                                         std::vector<ssize_t> lits);
+static std::optional<QDef> find_and(ssize_t lit, const QClauses &index,
+                                    size_t min_size);
+static std::optional<QDef> find_xor(ssize_t var, const QClauses &index);
+static std::optional<QDef> find_ite(ssize_t var, const QClauses &index);
+static std::optional<QDef> find_definition(ssize_t var,
+                                           const QClauses &index);
 static std::string to_string(const QVarType &var_type);
 static std::string to_string(const QGateType &gate_type);
 static std::string to_string(const QRef &ref, ssize_t gate_shift);
@@ -65,6 +91,183 @@ QCir qimply(QCir self, const QCir &other) {
   return self;
 }
 
+// Recovers and, xor and ite gates from their Tseitin clauses. A variable is
+// only replaced by its definition if all of its occurrences are in clauses of
+// the same conjunction, which is existential under positive and universal
+// under negative polarity, and if every variable its definition transitively
+// depends on is bound in the same or an earlier quantifier block. Then the
+// definition fixes the only relevant value of the variable at the point it is
+// bound, and the conjunction is equivalent to the one with the definition
+// substituted. Replaced variables are dropped from the prefix.
+QCir qextract(QCir self) {
+  const auto n_vars{self.vars.size()};
+  const auto n_gates{self.gates.size()};
+  std::vector<size_t> var_uses(n_vars + 1), gate_uses(n_gates + 1);
+  auto count = [&](const QRef &ref) {
+    ++((ref.type == QRefType::Var) ? var_uses : gate_uses)[std::abs(ref.id)];
+  };
+  for (auto const &gate : self.gates)
+    std::ranges::for_each(gate.refs, count);
+  count(self.output);
+
+  // Polarity under which each gate is reached: 1 positive, 2 negative, 3 both
+  std::vector<uint8_t> polarity(n_gates + 1);
+  if (self.output.type == QRefType::Gate)
+    polarity[std::abs(self.output.id)] = (self.output.id < 0) ? 2 : 1;
+  for (size_t i{n_gates}; i > 0; --i) {
+    auto const &gate{self.gates[i - 1]};
+    for (auto const &ref : gate.refs) {
+      if (ref.type != QRefType::Gate) continue;
+      uint8_t pol{polarity[i]};
+      if (gate.type == QGateType::Xor || gate.type == QGateType::Ite)
+        pol = pol ? 3 : 0;
+      else if (ref.id < 0)
+        pol = ((pol & 1) << 1) | (pol >> 1);
+      polarity[std::abs(ref.id)] |= pol;
+    }
+  }
+
+  auto is_clause = [&](const QRef &ref) {
+    if (ref.type != QRefType::Gate || ref.id < 0 || gate_uses[ref.id] != 1)
+      return false;
+    auto const &gate{self.gates[ref.id - 1]};
+    return gate.type == QGateType::Or &&
+           std::ranges::all_of(gate.refs, [](auto const &lit) {
+             return lit.type == QRefType::Var;
+           });
+  };
+
+  std::vector<std::optional<QDef>> defs(n_vars + 1);
+  std::vector<ssize_t> consumer(n_gates + 1);
+  for (size_t i{1}; i <= n_gates; ++i) {
+    auto const &gate{self.gates[i - 1]};
+    if (gate.type != QGateType::And || (polarity[i] != 1 && polarity[i] != 2))
+      continue;
+    const auto quantifier{(polarity[i] == 1) ? QVarType::Exists
+                                             : QVarType::ForAll};
+    QClauses index;
+    std::map<ssize_t, size_t> local_uses;
+    for (auto const &ref : gate.refs) {
+      if (!is_clause(ref)) continue;
+      std::vector<ssize_t> lits;
+      for (auto const &lit : self.gates[ref.id - 1].refs) {
+        lits.push_back(lit.id);
+        ++local_uses[std::abs(lit.id)];
+      }
+      std::ranges::sort(lits);
+      lits.erase(std::unique(std::begin(lits), std::end(lits)), std::end(lits));
+      auto [it, fresh]{index.ids.emplace(lits, ref.id)};
+      if (!fresh) continue;
+      for (auto lit : it->first)
+        index.occurs[lit].push_back(&it->first);
+    }
+    for (auto [var, uses] : local_uses) {
+      if (uses != var_uses[var] || self.vars[var - 1] != quantifier) continue;
+      if (auto def{find_definition(var, index)}) {
+        for (auto id : def->clauses) {
+          consumer[id] = var;
+          index.used.insert(id);
+        }
+        defs[var] = std::move(def);
+      }
+    }
+  }
+
+  // Quantifier block of each variable in the printed prefix
+  std::vector<size_t> block(n_vars + 1);
+  std::optional<QVarType> previous;
+  for (size_t var{1}, current{0u}; var <= n_vars; ++var) {
+    if (self.vars[var - 1] == QVarType::Defined) continue;
+    if (previous && self.vars[var - 1] != *previous) ++current;
+    previous = self.vars[var - 1];
+    block[var] = current;
+  }
+
+  // Order definitions by their dependencies and drop those closing a cycle or
+  // depending on a variable bound in a later quantifier block
+  std::vector<size_t> order, support(n_vars + 1);
+  auto support_block = [&](size_t var) {
+    return defs[var] ? support[var] : block[var];
+  };
+  std::vector<uint8_t> state(n_vars + 1);
+  for (size_t var{1}; var <= n_vars; ++var) {
+    if (!defs[var] || state[var]) continue;
+    std::vector<std::pair<size_t, size_t>> stack{{var, 0u}};
+    state[var] = 1;
+    while (!stack.empty()) {
+      auto &[top, next]{stack.back()};
+      if (!defs[top] || next == defs[top]->lits.size()) {
+        if (defs[top]) {
+          for (auto lit : defs[top]->lits)
+            support[top] = std::max(support[top],
+                                    support_block(std::abs(lit)));
+          if (support[top] > block[top])
+            defs[top].reset();
+          else
+            order.push_back(top);
+        }
+        state[top] = 2;
+        stack.pop_back();
+        continue;
+      }
+      const auto input{static_cast<size_t>(std::abs(defs[top]->lits[next++]))};
+      if (!defs[input] || state[input] == 2) continue;
+      if (state[input] == 1) {
+        defs[top].reset();
+        continue;
+      }
+      state[input] = 1;
+      stack.push_back({input, 0u});
+    }
+  }
+
+  auto consumed = [&](size_t id) {
+    return consumer[id] != 0 && defs[consumer[id]].has_value();
+  };
+  std::vector<QRef> var_refs(n_vars + 1);
+  std::vector<ssize_t> gate_ids(n_gates + 1);
+  auto resolve = [&](const QRef &ref) {
+    const auto id{std::abs(ref.id)};
+    QRef result{ref};
+    if (ref.type == QRefType::Gate)
+      result = {gate_ids[id], QRefType::Gate};
+    else if (defs[id])
+      result = var_refs[id];
+    else
+      return result;
+    if (ref.id < 0) result.id = -result.id;
+    return result;
+  };
+  std::vector<QGate> gates;
+  for (auto var : order) {
+    auto const &def{*defs[var]};
+    std::vector<QRef> refs;
+    refs.reserve(def.lits.size());
+    for (auto lit : def.lits)
+      refs.push_back(resolve({lit, QRefType::Var}));
+    if (def.type == QGateType::And && refs.size() == 1) {
+      var_refs[var] = refs.front();
+    } else {
+      gates.push_back({refs, def.type});
+      var_refs[var] = {static_cast<ssize_t>(gates.size()), QRefType::Gate};
+    }
+    if (def.negated) var_refs[var].id = -var_refs[var].id;
+    self.vars[var - 1] = QVarType::Defined;
+  }
+  for (size_t i{1}; i <= n_gates; ++i) {
+    if (consumed(i)) continue;
+    std::vector<QRef> refs;
+    for (auto const &ref : self.gates[i - 1].refs)
+      if (ref.type == QRefType::Var || !consumed(std::abs(ref.id)))
+        refs.push_back(resolve(ref));
+    gates.push_back({refs, self.gates[i - 1].type});
+    gate_ids[i] = static_cast<ssize_t>(gates.size());
+  }
+  self.output = resolve(self.output);
+  self.gates = std::move(gates);
+  return self;
+}
+
 static QRef shift_ref(const QRef &ref, ssize_t shift) {
   return {ref.id + ((ref.id < 0) ? -shift : shift), ref.type};
 }
@@ -85,18 +288,146 @@ static QRef merge_cir(QCir &left, const QCir &right) {
                    (right.output.type == QRefType::Gate) ? shift : 0);
 }
 
+static std::optional<size_t> find_clause(const QClauses &index,
+                                         std::vector<ssize_t> lits) {
+  std::ranges::sort(lits);
+  lits.erase(std::unique(std::begin(lits), std::end(lits)), std::end(lits));
+  auto it{index.ids.find(lits)};
+  if (it == std::end(index.ids) || index.used.contains(it->second)) return {};
+  return it->second;
+}
+
+// lit <-> (a1 & ... & ak): (lit | -a1 | ... | -ak), (-lit | a1), ...,
+// (-lit | ak)
+static std::optional<QDef> find_and(ssize_t lit, const QClauses &index,
+                                    size_t min_size) {
+  auto it{index.occurs.find(lit)};
+  if (it == std::end(index.occurs)) return {};
+  for (auto const *lits : it->second) {
+    auto id{find_clause(index, *lits)};
+    if (!id || lits->size() < min_size) continue;
+    QDef def{QGateType::And, {}, lit < 0, {*id}};
+    bool found{true};
+    for (auto other : *lits) {
+      if (other == lit) continue;
+      auto binary{find_clause(index, {-lit, -other})};
+      if (std::abs(other) == std::abs(lit) || !binary) {
+        found = false;
+        break;
+      }
+      def.lits.push_back(-other);
+      def.clauses.push_back(*binary);
+    }
+    if (found) return def;
+  }
+  return {};
+}
+
+// var <-> (a ^ b): the four ternary clauses excluding one parity
+static std::optional<QDef> find_xor(ssize_t var, const QClauses &index) {
+  for (auto lit : {var, -var}) {
+    auto it{index.occurs.find(lit)};
+    if (it == std::end(index.occurs)) continue;
+    for (auto const *lits : it->second) {
+      if (lits->size() != 3) continue;
+      std::vector<ssize_t> clause{var};
+      for (auto other : *lits)
+        if (other != lit) clause.push_back(std::abs(other));
+      if (clause[1] == var || clause[2] == var || clause[1] == clause[2])
+        continue;
+      const auto parity{std::ranges::count_if(
+                            *lits, [](auto other) { return other < 0; }) %
+                        2};
+      QDef def{QGateType::Xor, {clause[1], clause[2]}, parity == 0, {}};
+      for (unsigned signs{0u}; signs < 8u; ++signs) {
+        if (std::popcount(signs) % 2 != parity) continue;
+        auto signed_clause{clause};
+        for (size_t i{0u}; i < 3u; ++i)
+          if (signs & (1u << i)) signed_clause[i] = -signed_clause[i];
+        auto id{find_clause(index, signed_clause)};
+        if (!id) break;
+        def.clauses.push_back(*id);
+      }
+      if (def.clauses.size() == 4u) return def;
+    }
+  }
+  return {};
+}
+
+// var <-> (c ? t : e): (-var | -c | t), (-var | c | e), (var | -c | -t),
+// (var | c | -e)
+static std::optional<QDef> find_ite(ssize_t var, const QClauses &index) {
+  auto it{index.occurs.find(-var)};
+  if (it == std::end(index.occurs)) return {};
+  auto third = [&](const std::vector<ssize_t> &lits, ssize_t a, ssize_t b) {
+    for (auto lit : lits)
+      if (lit != a && lit != b) return lit;
+    return ssize_t{0};
+  };
+  for (auto const *lits : it->second) {
+    if (lits->size() != 3) continue;
+    const auto x{third(*lits, -var, -var)}, y{third(*lits, -var, x)};
+    if (std::abs(x) == var || std::abs(y) == var || std::abs(x) == std::abs(y))
+      continue;
+    for (auto [cond, then] : {std::pair{-x, y}, std::pair{-y, x}}) {
+      auto with_cond{index.occurs.find(cond)};
+      if (with_cond == std::end(index.occurs)) continue;
+      auto const &candidates{
+          (with_cond->second.size() < it->second.size()) ? with_cond->second
+                                                          : it->second};
+      for (auto const *other : candidates) {
+        if (other->size() != 3 ||
+            !std::ranges::binary_search(*other, cond) ||
+            !std::ranges::binary_search(*other, -var))
+          continue;
+        const auto other_else{third(*other, -var, cond)};
+        if (std::abs(other_else) == var ||
+            std::abs(other_else) == std::abs(cond))
+          continue;
+        std::vector<std::optional<size_t>> ids{
+            find_clause(index, {-var, -cond, then}),
+            find_clause(index, {-var, cond, other_else}),
+            find_clause(index, {var, -cond, -then}),
+            find_clause(index, {var, cond, -other_else})};
+        if (!std::ranges::all_of(ids, [](auto id) { return id.has_value(); }))
+          continue;
+        QDef def{QGateType::Ite, {cond, then, other_else}, false, {}};
+        for (auto id : ids)
+          def.clauses.push_back(*id);
+        return def;
+      }
+    }
+  }
+  return {};
+}
+
+static std::optional<QDef> find_definition(ssize_t var,
+                                           const QClauses &index) {
+  for (auto lit : {var, -var})
+    if (auto def{find_and(lit, index, 3u)}) return def;
+  if (auto def{find_xor(var, index)}) return def;
+  if (auto def{find_ite(var, index)}) return def;
+  // Plain equivalences last, they might hide a gate of the other variable
+  for (auto lit : {var, -var})
+    if (auto def{find_and(lit, index, 2u)}) return def;
+  return {};
+}
+
 std::ostream &operator<<(std::ostream &os, const QCir &cir) {
   os << "#QCIR-G14 " << cir.vars.size() << "\n";
+  std::optional<QVarType> block;
   size_t i{0u};
   for (; i < cir.vars.size(); ++i) {
-    if (i == 0 || cir.vars[i] != cir.vars[i - 1]) {
-      if (i > 0) os << ")\n";
+    if (cir.vars[i] == QVarType::Defined) continue;
+    if (cir.vars[i] != block) {
+      if (block) os << ")\n";
       os << to_string(cir.vars[i]) << "(";
+      block = cir.vars[i];
     } else
       os << ", ";
     os << (i + 1);
   }
-  if (cir.vars.size() > 0) os << ")\n";
+  if (block) os << ")\n";
   os << "output(" << to_string(cir.output, cir.vars.size()) << ")\n";
   for (auto &gate : cir.gates) {
     os << (i++ + 1) << " = " << to_string(gate, cir.vars.size()) << "\n";
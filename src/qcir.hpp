@@ -5,7 +5,7 @@
 
 #include "cnf.hpp"
 
-enum class QVarType { Exists, ForAll };
+enum class QVarType { Exists, ForAll, Defined };
 enum class QRefType { Gate, Var };
 enum class QGateType { And, Or, Xor, Ite };
 struct QRef {
@@ -29,5 +29,6 @@ QCir qneg(QCir self);
 QCir qand(QCir self, const QCir &other);
 QCir qor(QCir self, const QCir &other);
 QCir qimply(QCir self, const QCir &other);
+QCir qextract(QCir self);
 
 std::ostream &operator<<(std::ostream &os, const QCir &cir);